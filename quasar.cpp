@@ -19,6 +19,9 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 // Convert arbitrary types (e.g. integers) to a string
 template <typename T> static std::string to_string(T x) {
@@ -600,16 +603,56 @@ static inline int do_accept(void) {
 #endif
 }
 
-int main(int argc, char *argv[]) {
-  // Open database
+// Identity of the database file at the time it was opened, used to
+// notice when updatedb_sql.pl has replaced or rewritten it.
+struct DbIdentity {
+  dev_t dev;
+  ino_t ino;
+  time_t mtime;
+  int data_version;
+};
+
+// Return PRAGMA data_version, which changes whenever another connection
+// commits to the database file, or -1 on error.
+static int db_data_version(sqlite3 *dbh) {
+  sqlite3_stmt *stmt = NULL;
+  int version = -1;
+  if ( sqlite3_prepare_v2(dbh, "PRAGMA data_version", -1, &stmt, NULL)
+       == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW )
+    version = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+  return version;
+}
+
+// Ask the kernel to start reading the whole database file into the page
+// cache in the background, so the first queries after (re)opening are warm.
+static void db_prefetch(const char *dbfile) {
+#ifdef POSIX_FADV_WILLNEED
+  int fd = open(dbfile, O_RDONLY);
+  if ( fd < 0 )
+    return;
+  posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+  close(fd);
+#endif
+}
+
+// Open the database read-only, install custom functions and configure
+// memory-mapped I/O. Returns NULL (after printing an error) on failure.
+static sqlite3 *db_open(const char *dbfile, DbIdentity *ident) {
+  // Stat before opening, so a replacement racing with the open is
+  // detected (and reopened) on the next request rather than missed.
+  struct stat st;
+  if ( stat(dbfile, &st) != 0 ) {
+    perror(dbfile);
+    return NULL;
+  }
+
   sqlite3 *dbh = NULL;
-  const char *dbfile = getenv("QUASAR_DBFILE");
-  if ( !dbfile ) dbfile = "quasar.db";
   int rc = sqlite3_open_v2(dbfile, &dbh, SQLITE_OPEN_READONLY, NULL);
   if ( rc != SQLITE_OK ) {
     fprintf(stderr, "sqlite open: %s: %s\n", dbfile, sqlite3_errmsg(dbh));
     sqlite3_close(dbh);
-    return 1;
+    return NULL;
   }
 
   // Install custom function
@@ -619,11 +662,66 @@ int main(int argc, char *argv[]) {
   if ( rc != SQLITE_OK ) {
     fprintf(stderr, "sqlite create function: %s\n", sqlite3_errmsg(dbh));
     sqlite3_close(dbh);
-    return 1;
+    return NULL;
   }
 
+  // Use memory-mapped I/O (QUASAR_MMAP_SIZE bytes, default 256 MiB) so
+  // reads are served straight from the page cache. Not fatal if the
+  // SQLite build doesn't support it.
+  const char *mmap_size = getenv("QUASAR_MMAP_SIZE");
+  std::string pragma = "PRAGMA mmap_size = " +
+    to_string(mmap_size ? atoll(mmap_size) : 268435456LL);
+  if ( sqlite3_exec(dbh, pragma.c_str(), NULL, NULL, NULL) != SQLITE_OK )
+    fprintf(stderr, "sqlite mmap_size: %s\n", sqlite3_errmsg(dbh));
+
+  const char *prefetch = getenv("QUASAR_PREFETCH");
+  if ( prefetch && atoi(prefetch) )
+    db_prefetch(dbfile);
+
+  ident->dev = st.st_dev;
+  ident->ino = st.st_ino;
+  ident->mtime = st.st_mtime;
+  ident->data_version = db_data_version(dbh);
+  return dbh;
+}
+
+// Check whether the database file was replaced (new inode, e.g. after
+// a rename) or modified (mtime or data_version) since it was opened.
+static int db_changed(sqlite3 *dbh, const char *dbfile,
+                      const DbIdentity &ident) {
+  struct stat st;
+  if ( stat(dbfile, &st) != 0 )
+    return 0;                   // Missing; keep using the old file for now
+  return st.st_dev != ident.dev || st.st_ino != ident.ino ||
+    st.st_mtime != ident.mtime || db_data_version(dbh) != ident.data_version;
+}
+
+int main(int argc, char *argv[]) {
+  // Open database
+  const char *dbfile = getenv("QUASAR_DBFILE");
+  if ( !dbfile ) dbfile = "quasar.db";
+  DbIdentity ident;
+  sqlite3 *dbh = db_open(dbfile, &ident);
+  if ( !dbh )
+    return 1;
+  int rc;
+
   // Response loop.
   while ( do_accept() ) {
+    // Pick up a database rewritten by updatedb_sql.pl. Closing the old
+    // connection discards its page cache; if the new file can't be
+    // opened yet, keep serving from the old one.
+    if ( db_changed(dbh, dbfile, ident) ) {
+      DbIdentity new_ident;
+      sqlite3 *new_dbh = db_open(dbfile, &new_ident);
+      if ( new_dbh ) {
+        if ( sqlite3_close(dbh) != SQLITE_OK )
+          fprintf(stderr, "sqlite close: %s\n", sqlite3_errmsg(dbh));
+        dbh = new_dbh;
+        ident = new_ident;
+      }
+    }
+
     Query query;
     if ( argc > 1 )
       query.ParseQuery(argv[1]);